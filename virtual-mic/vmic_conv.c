@@ -0,0 +1,158 @@
+/*
+ * Copyright 2021 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <rdkx_logger.h>
+#include "vmic_conv.h"
+
+// Sample converters from S16.  S24 is the low three bytes of a 32-bit container (S24_LE).
+#define VMIC_CONV_SAMPLE_S16(s)   ((int16_t)(s))
+#define VMIC_CONV_SAMPLE_S24(s)   ((int32_t)(s) * 256)
+#define VMIC_CONV_SAMPLE_S32(s)   ((int32_t)(s) * 65536)
+#define VMIC_CONV_SAMPLE_FLOAT(s) ((float)(s) * (1.0f / 32768.0f))
+
+// Load one S16 input sample.  memcpy avoids alignment and aliasing assumptions on the router buffer and compiles to a single load.
+static inline int16_t vmic_conv_load_s16(const uint8_t *src, uint32_t index) {
+   int16_t sample;
+   memcpy(&sample, src + index * sizeof(int16_t), sizeof(sample));
+   return(sample);
+}
+
+// Duplicate the mono signal on all CHANS channels.  CHANS is a constant so the inner loop is unrolled by the compiler.
+#define VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, CHANS)                                                         \
+static void vmic_conv_##NAME##_all_##CHANS(const uint8_t *src, void *dst, uint32_t sample_qty, uint32_t position) { \
+   TYPE *out = (TYPE *)dst;                                                                                   \
+   (void)position;                                                                                            \
+   for(uint32_t i = 0; i < sample_qty; i++) {                                                                 \
+      TYPE value = CONV(vmic_conv_load_s16(src, i));                                                          \
+      for(uint32_t c = 0; c < (CHANS); c++) {                                                                 \
+         out[c] = value;                                                                                      \
+      }                                                                                                       \
+      out += (CHANS);                                                                                         \
+   }                                                                                                          \
+}
+
+// Place the mono signal on one channel and silence the others, writing each frame once.
+#define VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, CHANS)                                                         \
+static void vmic_conv_##NAME##_pos_##CHANS(const uint8_t *src, void *dst, uint32_t sample_qty, uint32_t position) { \
+   TYPE *out = (TYPE *)dst;                                                                                   \
+   for(uint32_t i = 0; i < sample_qty; i++) {                                                                 \
+      for(uint32_t c = 0; c < (CHANS); c++) {                                                                 \
+         out[c] = (TYPE)0;                                                                                    \
+      }                                                                                                       \
+      out[position] = CONV(vmic_conv_load_s16(src, i));                                                       \
+      out += (CHANS);                                                                                         \
+   }                                                                                                          \
+}
+
+#define VMIC_CONV_KERNELS(NAME, TYPE, CONV) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 1) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 2) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 3) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 4) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 5) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 6) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 7) \
+   VMIC_CONV_KERNEL_ALL(NAME, TYPE, CONV, 8) \
+   VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, 2) \
+   VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, 3) \
+   VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, 4) \
+   VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, 5) \
+   VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, 6) \
+   VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, 7) \
+   VMIC_CONV_KERNEL_POS(NAME, TYPE, CONV, 8)
+
+VMIC_CONV_KERNELS(s16,   int16_t, VMIC_CONV_SAMPLE_S16)
+VMIC_CONV_KERNELS(s24,   int32_t, VMIC_CONV_SAMPLE_S24)
+VMIC_CONV_KERNELS(s32,   int32_t, VMIC_CONV_SAMPLE_S32)
+VMIC_CONV_KERNELS(float, float,   VMIC_CONV_SAMPLE_FLOAT)
+
+// Table order is the device format preference order.  Mono output has no positioned variant.  Index 0 is unused so the tables can be indexed by channel count.
+#define VMIC_CONV_TABLE_ENTRY(NAME, FORMAT, TYPE)                                                              \
+   { FORMAT, sizeof(TYPE),                                                                                     \
+     { NULL, vmic_conv_##NAME##_all_1, vmic_conv_##NAME##_all_2, vmic_conv_##NAME##_all_3, vmic_conv_##NAME##_all_4, \
+             vmic_conv_##NAME##_all_5, vmic_conv_##NAME##_all_6, vmic_conv_##NAME##_all_7, vmic_conv_##NAME##_all_8 }, \
+     { NULL, vmic_conv_##NAME##_all_1, vmic_conv_##NAME##_pos_2, vmic_conv_##NAME##_pos_3, vmic_conv_##NAME##_pos_4, \
+             vmic_conv_##NAME##_pos_5, vmic_conv_##NAME##_pos_6, vmic_conv_##NAME##_pos_7, vmic_conv_##NAME##_pos_8 } }
+
+typedef struct {
+   snd_pcm_format_t   format;
+   uint32_t           sample_size;
+   vmic_conv_kernel_t all[VMIC_CONV_CHANNELS_MAX + 1];
+   vmic_conv_kernel_t pos[VMIC_CONV_CHANNELS_MAX + 1];
+} vmic_conv_table_entry_t;
+
+static const vmic_conv_table_entry_t vmic_conv_table[] = {
+   VMIC_CONV_TABLE_ENTRY(s16,   SND_PCM_FORMAT_S16_LE,   int16_t),
+   VMIC_CONV_TABLE_ENTRY(s32,   SND_PCM_FORMAT_S32_LE,   int32_t),
+   VMIC_CONV_TABLE_ENTRY(s24,   SND_PCM_FORMAT_S24_LE,   int32_t),
+   VMIC_CONV_TABLE_ENTRY(float, SND_PCM_FORMAT_FLOAT_LE, float),
+};
+
+#define VMIC_CONV_TABLE_QTY (sizeof(vmic_conv_table) / sizeof(vmic_conv_table[0]))
+
+uint32_t vmic_conv_format_qty(void) {
+   return(VMIC_CONV_TABLE_QTY);
+}
+
+snd_pcm_format_t vmic_conv_format_get(uint32_t index) {
+   if(index >= VMIC_CONV_TABLE_QTY) {
+      return(SND_PCM_FORMAT_UNKNOWN);
+   }
+   return(vmic_conv_table[index].format);
+}
+
+bool vmic_conv_select(vmic_conv_t *conv, snd_pcm_format_t format, uint32_t channels, int32_t position) {
+   if(conv == NULL) {
+      XLOGD_ERROR("invalid params");
+      return(false);
+   }
+   if(channels == 0 || channels > VMIC_CONV_CHANNELS_MAX) {
+      XLOGD_ERROR("unsupported channel count <%u>", channels);
+      return(false);
+   }
+   if(position >= (int32_t)channels) {
+      XLOGD_ERROR("invalid position <%d> for <%u> channels", position, channels);
+      return(false);
+   }
+
+   for(uint32_t index = 0; index < VMIC_CONV_TABLE_QTY; index++) {
+      const vmic_conv_table_entry_t *entry = &vmic_conv_table[index];
+      if(entry->format != format) {
+         continue;
+      }
+      conv->position   = (position < 0) ? 0 : (uint32_t)position;
+      conv->frame_size = entry->sample_size * channels;
+
+      if(format == SND_PCM_FORMAT_S16_LE && channels == 1) { // Native input format
+         conv->kernel = NULL;
+      } else if(position < 0) {
+         conv->kernel = entry->all[channels];
+      } else {
+         conv->kernel = entry->pos[channels];
+      }
+      XLOGD_INFO("format <%s> channels <%u> position <%d> kernel <%s>", snd_pcm_format_name(format), channels, position, conv->kernel == NULL ? "NONE" : "SET");
+      return(true);
+   }
+
+   XLOGD_ERROR("unsupported format <%s>", snd_pcm_format_name(format));
+   return(false);
+}
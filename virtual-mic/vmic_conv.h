@@ -0,0 +1,76 @@
+/*
+ * Copyright 2021 Comcast Cable Communications Management, LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef __VMIC_CONV__
+#define __VMIC_CONV__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <alsa/asoundlib.h>
+
+/// @file vmic_conv.h
+///
+/// @brief Sample format and channel conversion for the virtual mic playback path
+/// @details The speech router always delivers 16-bit mono audio.  The kernels in this module convert it to the format and channel
+/// count negotiated with the playback device.  Each kernel is specialized at compile time for its destination format and channel
+/// count so the playback path runs without per-sample branching.
+
+#define VMIC_CONV_CHANNELS_MAX    (8)  ///< Maximum number of device channels supported by the upmix kernels
+#define VMIC_CONV_POSITION_ALL    (-1) ///< Place the mono signal on all device channels
+
+/// @brief Conversion kernel type
+/// @details Converts sample_qty mono S16 samples from src into sample_qty interleaved frames in dst.  The input is read bytewise so
+/// src may be the speech router's buffer with any alignment.
+/// @param[in]  src        the 16-bit mono input samples
+/// @param[out] dst        the output buffer in the device format, aligned for the device sample type
+/// @param[in]  sample_qty the number of input samples
+/// @param[in]  position   the channel index which carries the signal (only used by the positioned kernels)
+typedef void (*vmic_conv_kernel_t)(const uint8_t *src, void *dst, uint32_t sample_qty, uint32_t position);
+
+/// @brief Conversion state structure
+/// @details Describes the kernel selected for the negotiated device configuration.  A NULL kernel means the device accepts the
+/// input audio natively and no conversion is required.  The kernel is only valid while ready is true.
+typedef struct {
+   bool               ready;      ///< True once the device has been negotiated and started, set by the caller
+   vmic_conv_kernel_t kernel;     ///< The selected kernel or NULL for pass through
+   uint32_t           position;   ///< The channel index which carries the signal
+   uint32_t           frame_size; ///< The size of one output frame in bytes
+} vmic_conv_t;
+
+/// @brief Get the number of device sample formats supported by the kernels
+/// @return The function returns the number of supported formats.
+uint32_t vmic_conv_format_qty(void);
+
+/// @brief Get a supported device sample format
+/// @details Formats are returned in order of preference, starting with the native S16 input format.
+/// @param[in] index the preference index, less than vmic_conv_format_qty()
+/// @return The function returns the format or SND_PCM_FORMAT_UNKNOWN if the index is out of range.
+snd_pcm_format_t vmic_conv_format_get(uint32_t index);
+
+/// @brief Select a conversion kernel
+/// @details Function which selects the kernel for the negotiated device configuration.  It must be called once after the hardware
+/// parameters have been set and before any audio is played.  It does not set the ready flag.
+/// @param[out] conv     the conversion state to fill in
+/// @param[in]  format   the device sample format
+/// @param[in]  channels the device channel count
+/// @param[in]  position the channel index which carries the signal or VMIC_CONV_POSITION_ALL to duplicate it on all channels
+/// @return The function returns true for success, otherwise false.
+bool vmic_conv_select(vmic_conv_t *conv, snd_pcm_format_t format, uint32_t channels, int32_t position);
+
+#endif
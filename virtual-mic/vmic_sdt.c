@@ -27,6 +27,7 @@
 #include <time.h>
 #include <errno.h>
 #include "vmic_sdt_private.h"
+#include "vmic_conv.h"
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -46,7 +47,14 @@ static snd_pcm_hw_params_t *params;
 static snd_pcm_sw_params_t *sw_params;
 static snd_pcm_uframes_t frames;
 static snd_pcm_uframes_t period_size = 1870;
+static vmic_conv_t conv;
 char audio_buffer[3640];
+#define VMIC_CONV_BUFFER_SAMPLE_QTY ((sizeof(audio_buffer) / sizeof(int16_t)) * VMIC_CONV_CHANNELS_MAX)
+static union {
+   int16_t s16[VMIC_CONV_BUFFER_SAMPLE_QTY];
+   int32_t s32[VMIC_CONV_BUFFER_SAMPLE_QTY];
+   float   flt[VMIC_CONV_BUFFER_SAMPLE_QTY];
+} conv_buffer;
 #define VMIC_SDT_IDENTIFIER (0xC11FB9C2)
 
 static bool     vmic_sdt_object_is_valid(vmic_sdt_obj_t *obj);
@@ -59,7 +67,7 @@ static void vmic_sdt_handler_stream_end(void *data, const uuid_t uuid, xrsr_stre
 static bool vmic_sdt_handler_connected(void *data, const uuid_t uuid, xrsr_handler_send_t send, void *param, rdkx_timestamp_t *timestamp);
 static void vmic_sdt_handler_disconnected(void *data, const uuid_t uuid, xrsr_session_end_reason_t reason, bool retry, bool *detect_resume, rdkx_timestamp_t *timestamp);
 static int vmic_recv_audiodata(unsigned char* frame,uint32_t sample_qty);
-static int vmic_alsa_buffer_playback(unsigned char* audiodata);
+static int vmic_alsa_buffer_playback(unsigned char* audiodata, snd_pcm_uframes_t frame_qty);
 static void vmic_init();
 static void vmic_close();
 
@@ -128,22 +136,40 @@ bool vmic_sdt_handlers(vmic_sdt_object_t object, const vmic_sdt_handlers_t *hand
 int vmic_recv_audiodata(unsigned char* data, uint32_t size)
 {
   XLOGD_DEBUG("Received Buffer Size:%d",size);
-  memcpy(audio_buffer,data,size);
-  vmic_alsa_buffer_playback(audio_buffer);
+  if(size > sizeof(audio_buffer)) {
+     XLOGD_ERROR("buffer too large <%u>", size);
+     return(-1);
+  }
+  if(!conv.ready) {
+     XLOGD_ERROR("device not ready, dropping buffer");
+     return(-1);
+  }
+  uint32_t sample_qty = size / sizeof(int16_t);
+  if(conv.kernel == NULL) {
+     memcpy(audio_buffer,data,size);
+     return(vmic_alsa_buffer_playback(audio_buffer, sample_qty));
+  }
+  if(sample_qty * conv.frame_size > sizeof(conv_buffer)) {
+     XLOGD_ERROR("converted buffer too large <%u> frames", sample_qty);
+     return(-1);
+  }
+  (*conv.kernel)(data, &conv_buffer, sample_qty, conv.position);
+  return(vmic_alsa_buffer_playback((unsigned char *)&conv_buffer, sample_qty));
 }
-int vmic_alsa_buffer_playback(unsigned char* audio_stream)
+int vmic_alsa_buffer_playback(unsigned char* audio_stream, snd_pcm_uframes_t frame_qty)
 {
-  if (pcm = snd_pcm_writei(pcm_handle,audio_stream, frames) == -EPIPE) {
-       XLOGD_ERROR("ERROR: snd_pcm_writei:%s",snd_strerror(pcm));
+  snd_pcm_sframes_t rc = snd_pcm_writei(pcm_handle,audio_stream, frame_qty);
+  if (rc == -EPIPE) {
+       XLOGD_ERROR("ERROR: snd_pcm_writei:%s",snd_strerror(rc));
        snd_pcm_prepare(pcm_handle);
-  } else if (pcm < 0) {
-      XLOGD_ERROR("ERROR. Can't write to PCM device. %s\n", snd_strerror(pcm));
-  } else if ( pcm == -EAGAIN )
+  } else if ( rc == -EAGAIN )
   {
-       XLOGD_ERROR("ERROR. EAGAIN raised by  PCM device. %s\n", snd_strerror(pcm));
+       XLOGD_ERROR("ERROR. EAGAIN raised by  PCM device. %s\n", snd_strerror(rc));
        snd_pcm_prepare(pcm_handle);
+  } else if (rc < 0) {
+      XLOGD_ERROR("ERROR. Can't write to PCM device. %s\n", snd_strerror(rc));
   }
-
+  return((rc < 0) ? (int)rc : 0);
 }
 
 void vmic_sdt_destroy(vmic_sdt_object_t object) {
@@ -281,6 +307,9 @@ uint64_t vmic_sdt_time_get(void) {
 
 void vmic_init()
 {
+    /* Audio is dropped until negotiation completes and sets ready */
+    memset(&conv, 0, sizeof(conv));
+
     do
     {
     /* Open the PCM device in playback mode */
@@ -305,17 +334,38 @@ void vmic_init()
         break;
     }
 
-    if (pcm = snd_pcm_hw_params_set_format(pcm_handle, params,
-                                            SND_PCM_FORMAT_S16_LE) < 0)
+    /* Prefer the native S16 format, otherwise the first format the device accepts */
+    snd_pcm_format_t format = SND_PCM_FORMAT_UNKNOWN;
+    for (uint32_t index = 0; index < vmic_conv_format_qty(); index++)
     {
-        XLOGD_ERROR("ERROR: Can't set format. %s\n", snd_strerror(pcm));
+        if (snd_pcm_hw_params_test_format(pcm_handle, params, vmic_conv_format_get(index)) == 0)
+        {
+            format = vmic_conv_format_get(index);
+            break;
+        }
+    }
+
+    if (format == SND_PCM_FORMAT_UNKNOWN)
+    {
+        XLOGD_ERROR("ERROR: Device supports none of the conversion formats\n");
         snd_pcm_close(pcm_handle);
         break;
     }
 
-    if (pcm = snd_pcm_hw_params_set_channels(pcm_handle, params, channels) < 0)
+    int rc = snd_pcm_hw_params_set_format(pcm_handle, params, format);
+    if (rc < 0)
     {
-        XLOGD_ERROR("ERROR: Can't set channels number. %s\n", snd_strerror(pcm));
+        XLOGD_ERROR("ERROR: Can't set format. %s\n", snd_strerror(rc));
+        snd_pcm_close(pcm_handle);
+        break;
+    }
+
+    /* Prefer mono, otherwise the smallest channel count the device accepts */
+    channels = 1;
+    rc = snd_pcm_hw_params_set_channels_near(pcm_handle, params, &channels);
+    if (rc < 0)
+    {
+        XLOGD_ERROR("ERROR: Can't set channels number. %s\n", snd_strerror(rc));
         snd_pcm_close(pcm_handle);
         break;
     }
@@ -343,6 +393,32 @@ void vmic_init()
     }
 
 
+    /* Carry the signal on the mono or center channel if the device maps one, otherwise on all channels */
+    int32_t position = VMIC_CONV_POSITION_ALL;
+    if (channels > 1)
+    {
+        snd_pcm_chmap_t *chmap = snd_pcm_get_chmap(pcm_handle);
+        if (chmap != NULL)
+        {
+            for (uint32_t index = 0; index < chmap->channels && index < channels; index++)
+            {
+                if (chmap->pos[index] == SND_CHMAP_MONO || chmap->pos[index] == SND_CHMAP_FC)
+                {
+                    position = index;
+                    break;
+                }
+            }
+            free(chmap);
+        }
+    }
+
+    if (!vmic_conv_select(&conv, format, channels, position))
+    {
+        XLOGD_ERROR("ERROR: No conversion for format <%s> channels <%u>\n", snd_pcm_format_name(format), channels);
+        snd_pcm_close(pcm_handle);
+        break;
+    }
+
     /* Allocate buffer to hold single period */
     if (pcm = snd_pcm_hw_params_get_period_size(params, &frames, 0) < 0)
     {
@@ -359,55 +435,60 @@ void vmic_init()
         break;
     }
 
-    if ((pcm = snd_pcm_sw_params_malloc (&sw_params)) < 0) 
+    if ((rc = snd_pcm_sw_params_malloc (&sw_params)) < 0) 
     {
-         XLOGD_ERROR("cannot allocate software parameters structure (%s)\n",snd_strerror (pcm));
+         XLOGD_ERROR("cannot allocate software parameters structure (%s)\n",snd_strerror (rc));
 	 snd_pcm_close(pcm_handle);
 	 break;
     }
 
-     if ((pcm = snd_pcm_sw_params_current (pcm_handle, sw_params)) < 0) 
+     if ((rc = snd_pcm_sw_params_current (pcm_handle, sw_params)) < 0) 
      {
-          XLOGD_ERROR("cannot initialize software parameters structure (%s)\n",snd_strerror (pcm));
+          XLOGD_ERROR("cannot initialize software parameters structure (%s)\n",snd_strerror (rc));
 	  snd_pcm_close(pcm_handle);
 	  break;
      }
-     if ((pcm = snd_pcm_sw_params_set_start_threshold(pcm_handle, sw_params, ( 20 * period_size))) < 0) 
+     if ((rc = snd_pcm_sw_params_set_start_threshold(pcm_handle, sw_params, ( 20 * period_size))) < 0) 
      {
-         XLOGD_ERROR("cannot set start mode (%s)\n",snd_strerror (pcm));
+         XLOGD_ERROR("cannot set start mode (%s)\n",snd_strerror (rc));
 	 snd_pcm_close(pcm_handle);
 	 break;
      }
 
-     if ((pcm = snd_pcm_sw_params (pcm_handle, sw_params)) < 0) 
+     if ((rc = snd_pcm_sw_params (pcm_handle, sw_params)) < 0) 
      {
-          XLOGD_ERROR("cannot set software parameters (%s)\n",snd_strerror (pcm));
+          XLOGD_ERROR("cannot set software parameters (%s)\n",snd_strerror (rc));
 	  snd_pcm_close(pcm_handle);
 	  break;
      }
-     if ((pcm = snd_pcm_prepare (pcm_handle)) < 0) 
+     if ((rc = snd_pcm_prepare (pcm_handle)) < 0) 
      {
-         XLOGD_ERROR("cannot prepare audio interface for use (%s)\n",snd_strerror (pcm));
+         XLOGD_ERROR("cannot prepare audio interface for use (%s)\n",snd_strerror (rc));
 	 snd_pcm_close(pcm_handle);
 	 break;
      }
-     if (( pcm =  snd_pcm_start(pcm_handle))<0 )
+     if ((rc = snd_pcm_start(pcm_handle))<0 )
      {
-	 XLOGD_ERROR("cannot start pcm  (%s)\n",snd_strerror (pcm));
+	 XLOGD_ERROR("cannot start pcm  (%s)\n",snd_strerror (rc));
 	 snd_pcm_close(pcm_handle);
 	 break;
      }
 
+     conv.ready = true;
+
     }while(0);
 
 }
 
 void vmic_close()
 {
-   if ( NULL != pcm_handle)
+   /* Failed negotiation already closed the handle */
+   if ( NULL != pcm_handle && conv.ready)
    {
       snd_pcm_drain(pcm_handle);
       snd_pcm_close(pcm_handle);
    }
+   pcm_handle = NULL;
+   conv.ready = false;
 }
 